@@ -0,0 +1,158 @@
+#!/usr/bin/env python3
+"""Summarise the benchmark runs of Allrun.
+
+    ./collect.py [runs directory] [--warmup N]
+
+Every run directory holds benchmark.json and phaseTiming.csv. The first
+steps (default 5) are skipped and the rest averaged. Next to the runs
+directory this writes results.json with one record per run, and strong.csv
+and weak.csv with the scaling tables, which are also printed.
+"""
+
+import argparse
+import csv
+import json
+import os
+import sys
+
+PHASES = ["momentum", "pressure", "turbulence", "filter", "write", "step"]
+
+
+def read_run(run_dir, warmup):
+    with open(os.path.join(run_dir, "benchmark.json")) as f:
+        record = json.load(f)
+
+    with open(os.path.join(run_dir, "phaseTiming.csv")) as f:
+        rows = list(csv.DictReader(f))
+
+    if len(rows) > warmup:
+        rows = rows[warmup:]
+    if not rows:
+        return None
+
+    n = len(rows)
+    for phase in PHASES:
+        record[phase] = sum(float(r[phase]) for r in rows) / n
+    record["filterIterations"] = sum(int(r["filterIterations"]) for r in rows) / n
+    record["filterResidual"] = max(float(r["filterResidual"]) for r in rows)
+    record["maxRssKB"] = max(int(r["maxRss"]) for r in rows)
+    record["cellsPerRank"] = record["cells"] / record["ranks"]
+    record["stepsAveraged"] = n
+    record["run"] = os.path.basename(run_dir)
+
+    return record
+
+
+def scaling_table(records, key, weak):
+    """Rows of speedup and efficiency relative to the fewest ranks of a group"""
+    groups = {}
+    for r in records:
+        groups.setdefault(key(r), []).append(r)
+
+    table = []
+    for group in sorted(groups):
+        runs = sorted(groups[group], key=lambda r: r["ranks"])
+        base = runs[0]
+        for r in runs:
+            speedup = base["step"] / r["step"]
+            if weak:
+                efficiency = speedup
+            else:
+                efficiency = speedup * base["ranks"] / r["ranks"]
+
+            row = {
+                "case": r["case"],
+                "size": r["size"],
+                "cells": r["cells"],
+                "ranks": r["ranks"],
+                "secondsPerStep": r["step"],
+                "speedup": speedup,
+                "efficiency": efficiency,
+            }
+            for phase in PHASES[:-1]:
+                row[phase] = r[phase]
+            row["filterIterations"] = r["filterIterations"]
+            row["maxRssKB"] = r["maxRssKB"]
+            table.append(row)
+
+    return table
+
+
+def write_table(path, table):
+    if not table:
+        return
+
+    with open(path, "w", newline="") as f:
+        writer = csv.DictWriter(f, fieldnames=list(table[0]))
+        writer.writeheader()
+        writer.writerows(table)
+
+
+def print_table(title, table):
+    if not table:
+        return
+
+    print(title)
+    print(
+        "{:8} {:>5} {:>10} {:>5} {:>10} {:>8} {:>6} {:>9} {:>9} {:>10}".format(
+            "case", "size", "cells", "ranks", "s/step", "speedup",
+            "eff", "filter", "filterIt", "maxRss"
+        )
+    )
+    for r in table:
+        print(
+            "{:8} {:5d} {:10d} {:5d} {:10.4g} {:8.3f} {:6.2f} {:9.3g} "
+            "{:9.1f} {:10d}".format(
+                r["case"], r["size"], r["cells"], r["ranks"],
+                r["secondsPerStep"], r["speedup"], r["efficiency"],
+                r["filter"], r["filterIterations"], r["maxRssKB"]
+            )
+        )
+    print()
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument(
+        "runs", nargs="?",
+        default=os.path.join(os.path.dirname(os.path.abspath(__file__)), "runs")
+    )
+    parser.add_argument("--warmup", type=int, default=5)
+    args = parser.parse_args()
+
+    records = []
+    for name in sorted(os.listdir(args.runs)):
+        run_dir = os.path.join(args.runs, name)
+        if not os.path.isfile(os.path.join(run_dir, "phaseTiming.csv")):
+            print("Skipping {}: no phaseTiming.csv".format(name), file=sys.stderr)
+            continue
+
+        record = read_run(run_dir, args.warmup)
+        if record:
+            records.append(record)
+
+    out_dir = os.path.dirname(os.path.abspath(args.runs))
+
+    with open(os.path.join(out_dir, "results.json"), "w") as f:
+        json.dump(records, f, indent=2)
+
+    strong = scaling_table(
+        [r for r in records if r["mode"] == "strong"],
+        lambda r: (r["case"], r["size"]),
+        weak=False,
+    )
+    weak = scaling_table(
+        [r for r in records if r["mode"] == "weak"],
+        lambda r: r["case"],
+        weak=True,
+    )
+
+    write_table(os.path.join(out_dir, "strong.csv"), strong)
+    write_table(os.path.join(out_dir, "weak.csv"), weak)
+
+    print_table("Strong scaling", strong)
+    print_table("Weak scaling", weak)
+
+
+if __name__ == "__main__":
+    main()
@@ -1,12 +1,409 @@
 
+#include "EdgeMap.H"
+#include "Map.H"
 #include "fvCFD.H"
+#include "labelIOList.H"
+#include "mapDistribute.H"
+#include "philox.h"
+#include "syncTools.H"
 
-int main(int argc, char* argv[])
+// Boundary points that are allowed to move together with everything the
+// displacement needs, so the displacement loop only touches these lists
+struct movablePoints
+{
+  Foam::DynamicList<Foam::label>  mesh_points;
+  Foam::DynamicList<Foam::label>  global_ids;
+  Foam::DynamicList<Foam::vector> normals;
+};
+
+// Labels in the undecomposed mesh, identity when running in serial
+Foam::labelList global_ids(const Foam::polyMesh& mesh, const Foam::word& name,
+                           const Foam::label size)
 {
-  Foam::argList::noParallel();
-// Foam::argList::addArgument("distort magnitude [0-1]");
+  if (!Foam::Pstream::parRun()) { return Foam::identity(size); }
+
+  Foam::labelIOList addressing(Foam::IOobject(
+      name, mesh.facesInstance(), Foam::polyMesh::meshSubDir, mesh,
+      Foam::IOobject::MUST_READ, Foam::IOobject::NO_WRITE));
+
+  return std::move(addressing);
+}
+
+// Interior points of a patch and their normals. Both are decided in the same
+// way on every decomposition: across processor boundaries the perimeter test
+// and the normal (taken from the face with the lowest global label) are
+// synchronised.
+void add_patch_points(movablePoints& movable, const Foam::polyMesh& mesh,
+                      const Foam::polyPatch& patch,
+                      const Foam::labelList& point_ids,
+                      const Foam::labelList& face_ids)
+{
+  using namespace Foam;
+
+  const auto& mesh_points = patch.meshPoints();
+  const auto& edges       = patch.edges();
+  const auto& point_faces = patch.pointFaces();
+  const auto& normals     = patch.faceNormals();
+
+  // An edge used by a single face is on the perimeter, unless the second face
+  // of the patch is on another processor
+  EdgeMap<label> edge_faces(2 * (edges.size() - patch.nInternalEdges()));
+  for (label ei = patch.nInternalEdges(); ei < edges.size(); ei++)
+  {
+    edge_faces.insert(
+        edge(mesh_points[edges[ei][0]], mesh_points[edges[ei][1]]), 1);
+  }
+  syncTools::syncEdgeMap(mesh, edge_faces, plusEqOp<label>(),
+                         mapDistribute::transform());
+
+  Map<label>  on_perimeter(2 * mesh_points.size());
+  Map<label>  first_face(2 * mesh_points.size());
+  Map<vector> normal(2 * mesh_points.size());
+  forAll(mesh_points, pi)
+  {
+    label min_face = labelMax;
+    for (const label fi : point_faces[pi])
+    {
+      min_face = min(min_face, face_ids[patch.start() + fi]);
+    }
+    on_perimeter.insert(mesh_points[pi], 0);
+    first_face.insert(mesh_points[pi], min_face);
+  }
+  // the synchronised map also holds the edges of other patches on the
+  // neighbouring processors, only the points of this patch are marked
+  forAllConstIters(edge_faces, iter)
+  {
+    if (iter.val() != 1) { continue; }
+
+    for (const label mesh_pi : {iter.key()[0], iter.key()[1]})
+    {
+      auto pt_iter = on_perimeter.find(mesh_pi);
+      if (pt_iter.found()) { pt_iter.val() = 1; }
+    }
+  }
+  syncTools::syncPointMap(mesh, on_perimeter, maxEqOp<label>(),
+                          mapDistribute::transform());
+  syncTools::syncPointMap(mesh, first_face, minEqOp<label>(),
+                          mapDistribute::transform());
 
-// clang-format off
+  // only the processor holding the face contributes, the others add exact
+  // zeros so the sum is bitwise the same as in serial
+  forAll(mesh_points, pi)
+  {
+    vector n = Zero;
+    for (const label fi : point_faces[pi])
+    {
+      if (face_ids[patch.start() + fi] == first_face[mesh_points[pi]])
+      {
+        n = normals[fi];
+      }
+    }
+    normal.insert(mesh_points[pi], n);
+  }
+  syncTools::syncPointMap(mesh, normal, plusEqOp<vector>(),
+                          mapDistribute::transform());
+
+  forAll(mesh_points, pi)
+  {
+    const label mesh_pi = mesh_points[pi];
+    if (on_perimeter[mesh_pi]) { continue; }
+
+    movable.mesh_points.append(mesh_pi);
+    movable.global_ids.append(point_ids[mesh_pi]);
+    movable.normals.append(normal[mesh_pi]);
+  }
+}
+
+// Displace the movable points, every point draws from its own stream so the
+// order does not matter
+void distort(Foam::pointField& points, const movablePoints& movable,
+             const Foam::pointField& original, const Foam::scalar distort_mag,
+             const Foam::label seed)
+{
+  forAll(movable.mesh_points, i)
+  {
+    const auto& n   = movable.normals[i];
+    const auto  r_v = rng::sample01(movable.global_ids[i], seed);
+    const auto  mv  = r_v - n * (n & r_v);
+
+    const auto mesh_pi = movable.mesh_points[i];
+    points[mesh_pi]    = original[mesh_pi] + distort_mag * mv;
+  }
+}
+
+struct cellCheck
+{
+  Foam::scalar ortho_quality;
+  Foam::scalar volume; // signed, negative for an inverted cell
+};
+
+// Centres of the cells across the coupled boundary faces for the given
+// points, indexed by boundary face. They stand in for the neighbour centre of
+// the same face when it is internal in serial.
+Foam::pointField neighbour_centres(const Foam::polyMesh& mesh,
+                                   const Foam::pointField& points)
+{
+  using namespace Foam;
+
+  // only the cells next to coupled faces are needed
+  pointField centres(mesh.nCells(), Zero);
+  for (const auto& patch : mesh.boundaryMesh())
+  {
+    if (!patch.coupled()) { continue; }
+
+    for (const label ci : patch.faceCells())
+    {
+      centres[ci] = mesh.cells()[ci].centre(points, mesh.faces());
+    }
+  }
+
+  pointField nei_centres;
+  syncTools::swapBoundaryCellPositions(mesh, centres, nei_centres);
+
+  return nei_centres;
+}
+
+// Orthogonal quality and volume of a single cell for the given points. On
+// internal and coupled faces the cell centre to neighbour centre direction is
+// checked as well, 'nei_centres' from neighbour_centres for the same points,
+// so the result is the same in serial and in parallel.
+cellCheck check_cell(const Foam::polyMesh& mesh, const Foam::pointField& points,
+                     const Foam::pointField& nei_centres,
+                     const Foam::label celli)
+{
+  using namespace Foam;
+
+  const auto& b_mesh = mesh.boundaryMesh();
+  const auto& faces  = mesh.faces();
+  const auto& cells  = mesh.cells();
+  const auto& own    = mesh.faceOwner();
+  const auto& nei    = mesh.faceNeighbour();
+
+  const auto cos_angle = [](const vector& a, const vector& b) {
+    return (a & b) / (mag(a) * mag(b) + VSMALL);
+  };
+
+  const point c_c = cells[celli].centre(points, faces);
+
+  cellCheck check{1.0, 0.0};
+  for (const label fi : cells[celli])
+  {
+    const vector s_f = own[fi] == celli ? faces[fi].areaNormal(points)
+                                        : -faces[fi].areaNormal(points);
+    const point c_f = faces[fi].centre(points);
+
+    // signed pyramid volumes, cell::mag adds their magnitudes
+    check.volume += (s_f & (c_f - c_c)) / 3;
+
+    check.ortho_quality
+        = min(check.ortho_quality, cos_angle(c_f - c_c, s_f));
+
+    if (fi < mesh.nInternalFaces())
+    {
+      const label other   = own[fi] == celli ? nei[fi] : own[fi];
+      const point c_other = cells[other].centre(points, faces);
+
+      check.ortho_quality
+          = min(check.ortho_quality, cos_angle(c_other - c_c, s_f));
+    }
+    else if (b_mesh[b_mesh.whichPatch(fi)].coupled())
+    {
+      const point& c_other = nei_centres[fi - mesh.nInternalFaces()];
+
+      check.ortho_quality
+          = min(check.ortho_quality, cos_angle(c_other - c_c, s_f));
+    }
+  }
+
+  return check;
+}
+
+// Back off the moves that make any adjacent cell worse than the limits, the
+// displacement is halved 'nBackOff' times before the point is put back. All
+// points are checked against the same state in each sweep, so the result
+// does not depend on the point order. A point accepted in one sweep may see
+// its neighbours move in the later ones, and a cell also changes through the
+// centre of a face neighbour, so at the end every cell around a moved point
+// and their face neighbours are checked again. The moved points of the cells
+// still breaking the limits and of their face neighbours are put back, until
+// none does.
+void guard_quality(Foam::pointField& points, const movablePoints& movable,
+                   const Foam::polyMesh& mesh, const Foam::dictionary& dict)
+{
+  using namespace Foam;
+
+  const auto min_oq     = dict.getOrDefault<scalar>("minOrthoQuality", 0.1);
+  const auto min_vr     = dict.getOrDefault<scalar>("minVolumeRatio", 0.5);
+  const auto n_back_off = dict.getOrDefault<label>("nBackOff", 4);
+
+  const auto& original    = mesh.points();
+  const auto& point_cells = mesh.pointCells();
+  const auto& cell_points = mesh.cellPoints();
+  const auto& cell_cells  = mesh.cellCells();
+  const auto& b_mesh      = mesh.boundaryMesh();
+  const auto  n_internal  = mesh.nInternalFaces();
+
+  // the cells of the moved points and their face neighbours, across the
+  // coupled faces as well
+  labelList near_moved(mesh.nCells(), 0);
+  for (const label mesh_pi : movable.mesh_points)
+  {
+    for (const label ci : point_cells[mesh_pi]) { near_moved[ci] = 1; }
+  }
+  labelList nei_near_moved;
+  syncTools::swapBoundaryCellList(mesh, near_moved, nei_near_moved);
+
+  labelHashSet checked(8 * movable.mesh_points.size());
+  forAll(near_moved, ci)
+  {
+    if (!near_moved[ci]) { continue; }
+
+    checked.insert(ci);
+    for (const label other : cell_cells[ci]) { checked.insert(other); }
+  }
+  for (const auto& patch : b_mesh)
+  {
+    if (!patch.coupled()) { continue; }
+
+    forAll(patch, i)
+    {
+      if (nei_near_moved[patch.start() + i - n_internal])
+      {
+        checked.insert(patch.faceCells()[i]);
+      }
+    }
+  }
+
+  // cells already worse than the limits only must not get worse
+  const pointField original_nei_centres = neighbour_centres(mesh, original);
+  Map<cellCheck>   reference(checked.size());
+  for (const label ci : checked)
+  {
+    reference.insert(ci, check_cell(mesh, original, original_nei_centres, ci));
+  }
+
+  const auto is_bad = [&](const label ci, const pointField& nei_centres) {
+    const auto& ref   = reference[ci];
+    const auto  check = check_cell(mesh, points, nei_centres, ci);
+    return check.ortho_quality < min(min_oq, ref.ortho_quality)
+           || check.volume < min_vr * ref.volume;
+  };
+
+  boolList active(movable.mesh_points.size(), true);
+  for (label sweep = 0; sweep <= n_back_off; sweep++)
+  {
+    const pointField nei_centres = neighbour_centres(mesh, points);
+
+    Map<bool>  bad_cells(reference.size());
+    Map<label> rejected(2 * movable.mesh_points.size());
+    forAll(movable.mesh_points, i)
+    {
+      if (!active[i]) { continue; }
+
+      const label mesh_pi = movable.mesh_points[i];
+
+      label reject = 0;
+      for (const label ci : point_cells[mesh_pi])
+      {
+        if (!bad_cells.found(ci))
+        {
+          bad_cells.insert(ci, is_bad(ci, nei_centres));
+        }
+        if (bad_cells[ci]) { reject = 1; }
+      }
+      rejected.insert(mesh_pi, reject);
+    }
+
+    // a point shared by processors is rejected if any of them rejects it
+    syncTools::syncPointMap(mesh, rejected, maxEqOp<label>(),
+                            mapDistribute::transform());
+
+    label n_rejected = 0;
+    forAll(movable.mesh_points, i)
+    {
+      if (!active[i]) { continue; }
+
+      const label mesh_pi = movable.mesh_points[i];
+      if (!rejected[mesh_pi])
+      {
+        active[i] = false;
+        continue;
+      }
+
+      n_rejected++;
+      points[mesh_pi] = sweep < n_back_off
+                            ? 0.5 * (original[mesh_pi] + points[mesh_pi])
+                            : original[mesh_pi];
+    }
+
+    reduce(n_rejected, sumOp<label>());
+    if (n_rejected == 0) { break; }
+
+    Info << "    backed off " << n_rejected << " points" << endl;
+  }
+
+  // Final check of the state that is written. A cell depends on its own
+  // points and on those of its face neighbours only, once these are all put
+  // back it has its reference state and passes, so the loop ends.
+  const auto revert_cell = [&](const label ci, Map<label>& reverted) {
+    for (const label mesh_pi : cell_points[ci]) { reverted.set(mesh_pi, 1); }
+  };
+
+  while (true)
+  {
+    const pointField nei_centres = neighbour_centres(mesh, points);
+
+    labelList  bad(mesh.nCells(), 0);
+    Map<label> reverted(2 * movable.mesh_points.size());
+    forAllConstIters(reference, iter)
+    {
+      const label ci = iter.key();
+      if (!is_bad(ci, nei_centres)) { continue; }
+
+      bad[ci] = 1;
+      revert_cell(ci, reverted);
+      for (const label other : cell_cells[ci]) { revert_cell(other, reverted); }
+    }
+
+    // the neighbours of bad cells on the other side of coupled faces
+    labelList nei_bad;
+    syncTools::swapBoundaryCellList(mesh, bad, nei_bad);
+    for (const auto& patch : b_mesh)
+    {
+      if (!patch.coupled()) { continue; }
+
+      forAll(patch, i)
+      {
+        if (nei_bad[patch.start() + i - n_internal])
+        {
+          revert_cell(patch.faceCells()[i], reverted);
+        }
+      }
+    }
+
+    syncTools::syncPointMap(mesh, reverted, maxEqOp<label>(),
+                            mapDistribute::transform());
+
+    label n_reverted = 0;
+    for (const label mesh_pi : movable.mesh_points)
+    {
+      if (reverted.found(mesh_pi) && points[mesh_pi] != original[mesh_pi])
+      {
+        points[mesh_pi] = original[mesh_pi];
+        n_reverted++;
+      }
+    }
+
+    reduce(n_reverted, sumOp<label>());
+    if (n_reverted == 0) { break; }
+
+    Info << "    put back " << n_reverted << " points" << endl;
+  }
+}
+
+int main(int argc, char* argv[])
+{
+  // clang-format off
   #include "setRootCase.H"
   #include "createTime.H"
   #include "createMesh.H"
@@ -16,54 +413,95 @@ int main(int argc, char* argv[])
                                  mesh, IOobject::MUST_READ,
                                  IOobject::NO_WRITE));
 
-  // compute the mean cell size and use it to set the distortion magnitude
-  auto distort_mag = 0.5 * settings.get<double>("distortMagnitude")
-                     * Foam::pow(Foam::average(mesh.cellVolumes()), 1. / 3.);
+  // compute the mean cell size and use it to set the distortion magnitude,
+  // 'cellSize' can be given to make the result independent of the summation
+  // order over the processors
+  const auto cell_size = settings.getOrDefault<scalar>(
+      "cellSize",
+      Foam::cbrt(gSum(mesh.cellVolumes())
+                 / returnReduce(mesh.nCells(), sumOp<label>())));
+
+  const auto seed = settings.getOrDefault<label>("seed", 0);
 
   auto& b_mesh     = mesh.boundaryMesh();
   auto  boundaries = settings.getOrDefault("boundaries", b_mesh.names());
 
-  // We only deal with quads here so, if we count a point 4 times it means it is
-  // in the "interior" of the boundary
-  Foam::List<Foam::label> points_count(mesh.nPoints(), 0);
+  // Random numbers are keyed on the undecomposed point labels
+  const labelList point_ids
+      = global_ids(mesh, "pointProcAddressing", mesh.nPoints());
+  labelList face_ids = global_ids(mesh, "faceProcAddressing", mesh.nFaces());
+  if (Pstream::parRun())
+  {
+    // face addressing is signed and offset by one to encode flips
+    for (label& id : face_ids) { id = mag(id) - 1; }
+  }
+
+  movablePoints movable;
+  forAll(b_mesh, bi)
+  {
+    if (!boundaries.found(b_mesh[bi].name())) { continue; }
+    if (b_mesh[bi].coupled()) { continue; }
+
+    add_patch_points(movable, mesh, b_mesh[bi], point_ids, face_ids);
+  }
 
-  auto             r_gen = Foam::Random();
   Foam::pointField points(mesh.points());
 
-  Foam::Info << "Modifing points..." << Foam::endl;
+  if (!settings.found("batch"))
+  {
+    Foam::Info << "Modifing points..." << Foam::endl;
 
-  forAll(b_mesh, bi)
+    const auto distort_mag
+        = 0.5 * settings.get<scalar>("distortMagnitude") * cell_size;
+    distort(points, movable, mesh.points(), distort_mag, seed);
+
+    if (settings.found("qualityGuard"))
+    {
+      guard_quality(points, movable, mesh, settings.subDict("qualityGuard"));
+    }
+
+    mesh.movePoints(points);
+
+    runTime.setTime(instant(runTime.constant()), 0);
+    mesh.write();
+
+    Foam::Info << "End!" << Foam::endl;
+    return 0;
+  }
+
+  // Batch mode: every (magnitude, seed) pair is written as the points of
+  // its own time directory, the rest of the mesh is read from constant
+  const auto& batch      = settings.subDict("batch");
+  const auto  magnitudes = batch.get<scalarList>("distortMagnitudes");
+  const auto  seeds      = batch.getOrDefault<labelList>("seeds", {seed});
+
+  label variant = 0;
+  for (const auto magnitude : magnitudes)
   {
-    if (boundaries.found(b_mesh[bi].name()))
+    for (const auto variant_seed : seeds)
     {
-      const auto boundary_normal = b_mesh[bi][0].unitNormal(mesh.points());
+      ++variant;
+      runTime.setTime(scalar(variant), variant);
 
-      Foam::List<Foam::label> points_count(mesh.nPoints(), 0);
+      Foam::Info << "Variant " << variant << ": distortMagnitude "
+                 << magnitude << ", seed " << variant_seed << Foam::endl;
 
-      forAll(b_mesh[bi], fi)
-      {
-        const auto& face = b_mesh[bi][fi];
-        forAll(face, pi) { points_count[face[pi]]++; }
-      }
+      distort(points, movable, mesh.points(), 0.5 * magnitude * cell_size,
+              variant_seed);
 
-      forAll(points, pi)
+      if (settings.found("qualityGuard"))
       {
-        if (points_count[pi] == 4)
-        {
-          const auto r_v = r_gen.sample01<Foam::vector>();
-          const auto mv  = r_v - boundary_normal * (boundary_normal & r_v);
-          points[pi]     = mesh.points()[pi] + distort_mag * mv;
-        }
-        points_count[pi] = 0;
+        guard_quality(points, movable, mesh, settings.subDict("qualityGuard"));
       }
+
+      pointIOField(IOobject("points", runTime.timeName(),
+                            polyMesh::meshSubDir, mesh, IOobject::NO_READ,
+                            IOobject::NO_WRITE, false),
+                   points)
+          .write();
     }
   }
 
-  mesh.movePoints(points);
-
-  runTime.setTime(instant(runTime.constant()), 0);
-  mesh.write();
-
   Foam::Info << "End!" << Foam::endl;
   return 0;
 }
@@ -0,0 +1,63 @@
+#ifndef DISTORTBOUNDARYMESH_PHILOX_H
+#define DISTORTBOUNDARYMESH_PHILOX_H
+
+#include <array>
+#include <cstdint>
+
+#include "vector.H"
+
+namespace rng
+{
+// Philox4x32-10 counter-based generator (Salmon et al., SC'11). The output is
+// a pure function of (counter, key), so every point can draw its own numbers
+// in any order, on any processor, and always get the same values.
+using uint4 = std::array<std::uint32_t, 4>;
+using uint2 = std::array<std::uint32_t, 2>;
+
+inline void mul_hi_lo(const std::uint32_t a, const std::uint32_t b,
+                      std::uint32_t& hi, std::uint32_t& lo)
+{
+  const std::uint64_t product = std::uint64_t(a) * std::uint64_t(b);
+  hi                          = std::uint32_t(product >> 32);
+  lo                          = std::uint32_t(product);
+}
+
+inline uint4 philox4x32(uint4 ctr, uint2 key)
+{
+  constexpr std::uint32_t m0 = 0xD2511F53;
+  constexpr std::uint32_t m1 = 0xCD9E8D57;
+  constexpr std::uint32_t w0 = 0x9E3779B9;
+  constexpr std::uint32_t w1 = 0xBB67AE85;
+
+  for (int round = 0; round < 10; round++)
+  {
+    if (round > 0)
+    {
+      key[0] += w0;
+      key[1] += w1;
+    }
+
+    std::uint32_t hi0, lo0, hi1, lo1;
+    mul_hi_lo(m0, ctr[0], hi0, lo0);
+    mul_hi_lo(m1, ctr[2], hi1, lo1);
+
+    ctr = {hi1 ^ ctr[1] ^ key[0], lo1, hi0 ^ ctr[3] ^ key[1], lo0};
+  }
+
+  return ctr;
+}
+
+// Uniform vector in [0, 1)^3 for a given id (e.g. global point label) and seed
+inline Foam::vector sample01(const std::uint64_t id, const std::uint64_t seed)
+{
+  const uint4 r = philox4x32(
+      {std::uint32_t(id), std::uint32_t(id >> 32), 0, 0},
+      {std::uint32_t(seed), std::uint32_t(seed >> 32)});
+
+  constexpr double scale = 1.0 / 4294967296.0;  // 2^-32
+  return Foam::vector(r[0] * scale, r[1] * scale, r[2] * scale);
+}
+
+}  // namespace rng
+
+#endif
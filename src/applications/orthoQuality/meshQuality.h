@@ -0,0 +1,219 @@
+#ifndef ORTHOQUALITY_MESHQUALITY_H
+#define ORTHOQUALITY_MESHQUALITY_H
+
+#include "Ostream.H"
+#include "Pstream.H"
+#include "labelList.H"
+#include "polyMesh.H"
+#include "scalarField.H"
+#include "syncTools.H"
+#include "unitConversion.H"
+
+namespace mq
+{
+// Per-cell quality metrics, all computed in a single pass over the faces
+struct cellQuality
+{
+  Foam::scalarField ortho_quality;  // min. cosine, 1 is perfect
+  Foam::scalarField non_ortho;      // max. non-orthogonality angle [deg]
+  Foam::scalarField skewness;       // max. face skewness
+  Foam::scalarField aspect_ratio;   // sum|Sf| / (6 V^(2/3)), 1 for a cube
+  Foam::scalarField volume_ratio;   // max. V_big / V_small over the faces
+
+  explicit cellQuality(const Foam::label n_cells)
+      : ortho_quality(n_cells, 1.0),
+        non_ortho(n_cells, 0.0),
+        skewness(n_cells, 0.0),
+        aspect_ratio(n_cells, 0.0),
+        volume_ratio(n_cells, 1.0)
+  {
+  }
+};
+
+inline Foam::scalar cos_angle(const Foam::vector& a, const Foam::vector& b)
+{
+  return (a & b) / (Foam::mag(a) * Foam::mag(b) + Foam::VSMALL);
+}
+
+inline Foam::scalar to_degrees(const Foam::scalar cos_value)
+{
+  return Foam::radToDeg(
+      Foam::acos(Foam::min(1.0, Foam::max(-1.0, cos_value))));
+}
+
+// Skewness of a face between two cell centres (checkMesh definition)
+inline Foam::scalar face_skewness(const Foam::point& c_own,
+                                  const Foam::point& c_nei,
+                                  const Foam::point& c_f,
+                                  const Foam::vector& s_f)
+{
+  const Foam::scalar d_own = Foam::mag(s_f & (c_f - c_own));
+  const Foam::scalar d_nei = Foam::mag(s_f & (c_nei - c_f));
+
+  const Foam::point intersection
+      = (d_nei * c_own + d_own * c_nei) / (d_own + d_nei + Foam::VSMALL);
+
+  return Foam::mag(c_f - intersection)
+         / (Foam::mag(c_nei - c_own) + Foam::VSMALL);
+}
+
+// Updates both cells sharing a face (the neighbour side may live on another
+// processor, in that case only the owner is updated)
+inline void update_face(cellQuality& q, const Foam::label own,
+                        const Foam::label nei, const Foam::point& c_own,
+                        const Foam::point& c_nei, const Foam::scalar v_own,
+                        const Foam::scalar v_nei, const Foam::point& c_f,
+                        const Foam::vector& s_f)
+{
+  const Foam::scalar cos_d = cos_angle(c_nei - c_own, s_f);
+  const Foam::scalar skew  = face_skewness(c_own, c_nei, c_f, s_f);
+  const Foam::scalar vr
+      = Foam::max(v_own, v_nei) / (Foam::min(v_own, v_nei) + Foam::VSMALL);
+  const Foam::scalar angle = to_degrees(cos_d);
+
+  q.ortho_quality[own]
+      = Foam::min(q.ortho_quality[own],
+                  Foam::min(cos_d, cos_angle(c_f - c_own, s_f)));
+  q.non_ortho[own]    = Foam::max(q.non_ortho[own], angle);
+  q.skewness[own]     = Foam::max(q.skewness[own], skew);
+  q.volume_ratio[own] = Foam::max(q.volume_ratio[own], vr);
+
+  if (nei < 0) { return; }
+
+  // normal points out of the neighbour, hence the flipped c_f - c_nei
+  q.ortho_quality[nei]
+      = Foam::min(q.ortho_quality[nei],
+                  Foam::min(cos_d, cos_angle(c_nei - c_f, s_f)));
+  q.non_ortho[nei]    = Foam::max(q.non_ortho[nei], angle);
+  q.skewness[nei]     = Foam::max(q.skewness[nei], skew);
+  q.volume_ratio[nei] = Foam::max(q.volume_ratio[nei], vr);
+}
+
+// Computes all the metrics, neighbour data across coupled (processor, cyclic)
+// patches is exchanged up front so the face loop needs no communication
+inline cellQuality compute(const Foam::polyMesh& mesh)
+{
+  const auto& c_centres = mesh.cellCentres();
+  const auto& volumes   = mesh.cellVolumes();
+  const auto& f_centres = mesh.faceCentres();
+  const auto& f_areas   = mesh.faceAreas();
+  const auto& own       = mesh.faceOwner();
+  const auto& nei       = mesh.faceNeighbour();
+
+  Foam::pointField nei_centres;
+  Foam::syncTools::swapBoundaryCellPositions(mesh, c_centres, nei_centres);
+  Foam::scalarField nei_volumes;
+  Foam::syncTools::swapBoundaryCellList(mesh, volumes, nei_volumes);
+
+  cellQuality       q(mesh.nCells());
+  Foam::scalarField sum_mag_sf(mesh.nCells(), 0.0);
+
+  for (Foam::label fi = 0; fi < mesh.nInternalFaces(); fi++)
+  {
+    const Foam::label o = own[fi];
+    const Foam::label n = nei[fi];
+
+    update_face(q, o, n, c_centres[o], c_centres[n], volumes[o], volumes[n],
+                f_centres[fi], f_areas[fi]);
+
+    const Foam::scalar mag_sf = Foam::mag(f_areas[fi]);
+    sum_mag_sf[o] += mag_sf;
+    sum_mag_sf[n] += mag_sf;
+  }
+
+  for (const Foam::polyPatch& pp : mesh.boundaryMesh())
+  {
+    forAll(pp, i)
+    {
+      const Foam::label fi  = pp.start() + i;
+      const Foam::label bfi = fi - mesh.nInternalFaces();
+      const Foam::label o   = own[fi];
+
+      sum_mag_sf[o] += Foam::mag(f_areas[fi]);
+
+      if (pp.coupled())
+      {
+        update_face(q, o, -1, c_centres[o], nei_centres[bfi], volumes[o],
+                    nei_volumes[bfi], f_centres[fi], f_areas[fi]);
+        continue;
+      }
+
+      // plain boundary: only the centre to face-centre direction counts and
+      // skewness is measured against the wall-normal projection
+      const Foam::vector n_f
+          = f_areas[fi] / (Foam::mag(f_areas[fi]) + Foam::VSMALL);
+      const Foam::vector d_wall
+          = n_f * (n_f & (f_centres[fi] - c_centres[o]));
+      const Foam::scalar skew
+          = Foam::mag(f_centres[fi] - (c_centres[o] + d_wall))
+            / (Foam::mag(d_wall) + Foam::VSMALL);
+
+      q.ortho_quality[o]
+          = Foam::min(q.ortho_quality[o],
+                      cos_angle(f_centres[fi] - c_centres[o], f_areas[fi]));
+      q.skewness[o] = Foam::max(q.skewness[o], skew);
+    }
+  }
+
+  forAll(q.aspect_ratio, ci)
+  {
+    q.aspect_ratio[ci] = sum_mag_sf[ci]
+                         / (6.0 * Foam::pow(volumes[ci], 2.0 / 3.0)
+                            + Foam::VSMALL);
+  }
+
+  return q;
+}
+
+// Fixed-range histogram, values outside of the range go to the end bins
+class histogram
+{
+  Foam::word      name_;
+  Foam::scalar    lo_;
+  Foam::scalar    hi_;
+  Foam::labelList counts_;
+
+ public:
+  histogram(const Foam::word& name, const Foam::scalar lo,
+            const Foam::scalar hi, const Foam::label n_bins)
+      : name_(name), lo_(lo), hi_(hi), counts_(n_bins, 0)
+  {
+  }
+
+  void add(const Foam::scalarField& values)
+  {
+    const Foam::scalar width = (hi_ - lo_) / counts_.size();
+    for (const Foam::scalar v : values)
+    {
+      const Foam::label bin = Foam::label((v - lo_) / width);
+      counts_[Foam::min(Foam::max(bin, 0), counts_.size() - 1)]++;
+    }
+  }
+
+  // Sum the counts over all processors
+  void reduce()
+  {
+    Foam::Pstream::listCombineGather(counts_, Foam::plusEqOp<Foam::label>());
+    Foam::Pstream::listCombineScatter(counts_);
+  }
+
+  void print() const
+  {
+    const Foam::scalar width = (hi_ - lo_) / counts_.size();
+    Foam::Info << name_ << " histogram:" << Foam::endl;
+    forAll(counts_, bi)
+    {
+      Foam::Info << "  [" << lo_ + bi * width << ", ";
+      if (bi == counts_.size() - 1) { Foam::Info << "inf)"; }
+      else
+      {
+        Foam::Info << lo_ + (bi + 1) * width << ")";
+      }
+      Foam::Info << "\t" << counts_[bi] << Foam::endl;
+    }
+  }
+};
+
+}  // namespace mq
+
+#endif
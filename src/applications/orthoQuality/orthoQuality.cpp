@@ -1,76 +1,122 @@
 
-
+#include "cellSet.H"
 #include "fvCFD.H"
-#include "scalarList.H"
+#include "meshQuality.h"
 
-int main(int argc, char* argv[])
+void write_field(const fvMesh& mesh, const word& name,
+                 const scalarField& values)
 {
-  Foam::argList::noParallel();
-// Foam::argList::addArgument("distort magnitude [0-1]");
+  volScalarField field(IOobject(name, mesh.time().timeName(), mesh,
+                                IOobject::NO_READ, IOobject::NO_WRITE),
+                       mesh, dimensionedScalar(dimless, Zero),
+                       calculatedFvPatchScalarField::typeName);
+  field.primitiveFieldRef() = values;
+  field.correctBoundaryConditions();
+
+  Info << "Writing field " << name << endl;
+  field.write();
+}
+
+void write_set(const fvMesh& mesh, const word& name, const boolList& selected)
+{
+  cellSet set(mesh, name, mesh.nCells() / 100 + 1);
+  forAll(selected, ci)
+  {
+    if (selected[ci]) { set.insert(ci); }
+  }
 
-// clang-format off
+  Info << "Writing " << returnReduce(set.size(), sumOp<label>())
+       << " cells to set " << name << endl;
+  set.write();
+}
+
+int main(int argc, char* argv[])
+{
+  Foam::argList::addNote(
+      "Report orthogonal quality, non-orthogonality, skewness, aspect ratio "
+      "and volume ratio of the mesh.");
+  Foam::argList::addBoolOption(
+      "writeFields", "Write the per-cell metrics as volScalarFields.");
+  Foam::argList::addOption(
+      "writeSets", "minOrthoQuality",
+      "Write cellSets of the cells with orthogonal quality below the value "
+      "and skewness above 'maxSkewness'.");
+  Foam::argList::addOption("maxSkewness", "scalar",
+                           "Skewness limit used by '-writeSets' (default 4).");
+  Foam::argList::addOption("nBins", "label",
+                           "Number of histogram bins (default 10).");
+
+  // clang-format off
   #include "setRootCase.H"
   #include "createTime.H"
   #include "createMesh.H"
   // clang-format on
 
-  const cellList cells     = mesh.cells();
-  const auto     c_centres = mesh.cellCentres();
-  const auto     f_centres = mesh.faceCentres();
-  const auto     faces     = mesh.faces();
-  const auto     own       = mesh.faceOwner();
-  const auto     nei       = mesh.faceNeighbour();
+  const label n_bins = args.getOrDefault<label>("nBins", 10);
+
+  const mq::cellQuality q = mq::compute(mesh);
+
+  const scalar min_oq = gMin(q.ortho_quality);
+
+  Info << nl << "Cells: " << returnReduce(mesh.nCells(), sumOp<label>())
+       << endl;
+  Info << "Min. orthogonal quality = " << min_oq << endl;
+  Info << "Corresponding angle = " << mq::to_degrees(min_oq) << endl;
+  Info << "Max. non-orthogonality = " << gMax(q.non_ortho) << endl;
+  Info << "Max. skewness = " << gMax(q.skewness) << endl;
+  Info << "Max. aspect ratio = " << gMax(q.aspect_ratio) << endl;
+  Info << "Max. volume ratio = " << gMax(q.volume_ratio) << nl << endl;
+
+  // clang-format off
+  mq::histogram histograms[] =
+  {
+    mq::histogram("Orthogonal quality", 0, 1, n_bins),
+    mq::histogram("Non-orthogonality", 0, 90, n_bins),
+    mq::histogram("Skewness", 0, 4, n_bins),
+    mq::histogram("Aspect ratio", 1, 21, n_bins),
+    mq::histogram("Volume ratio", 1, 11, n_bins)
+  };
+  // clang-format on
+
+  histograms[0].add(q.ortho_quality);
+  histograms[1].add(q.non_ortho);
+  histograms[2].add(q.skewness);
+  histograms[3].add(q.aspect_ratio);
+  histograms[4].add(q.volume_ratio);
 
-  List<scalar> oq(cells.size(), 0.0);
+  for (auto& hist : histograms)
+  {
+    hist.reduce();
+    hist.print();
+    Info << endl;
+  }
 
-  forAll(oq, i)
+  if (args.found("writeFields"))
   {
-    const auto cur_faces = cells[i];
-    const auto c_c       = c_centres[i];
+    write_field(mesh, "orthoQuality", q.ortho_quality);
+    write_field(mesh, "nonOrthoAngle", q.non_ortho);
+    write_field(mesh, "skewness", q.skewness);
+    write_field(mesh, "aspectRatio", q.aspect_ratio);
+    write_field(mesh, "volumeRatio", q.volume_ratio);
+  }
 
-    List<scalar> oq_faces(cur_faces.size(), 0.0);
+  if (args.found("writeSets"))
+  {
+    const scalar min_allowed  = args.get<scalar>("writeSets");
+    const scalar max_skewness = args.getOrDefault<scalar>("maxSkewness", 4);
 
-    // normal is in the directionm of a neighbour
-    forAll(cur_faces, fi)
+    boolList low_oq(mesh.nCells(), false);
+    boolList high_skew(mesh.nCells(), false);
+    forAll(low_oq, ci)
     {
-      face face = faces[cur_faces[fi]];
-      if (own[cur_faces[fi]] != i) { face.flip(); }
-
-      const auto c_f = f_centres[cur_faces[fi]];
-
-      oq_faces[fi] = (c_f - c_c)
-                     & face.areaNormal(mesh.points()) / mag(c_f - c_c)
-                           / mag(face.areaNormal(mesh.points()));
-
-      if (cur_faces[fi] < mesh.nInternalFaces())
-      {
-        label cell_neighbour;
-        if (own[cur_faces[fi]] == i) { cell_neighbour = nei[cur_faces[fi]]; }
-        else if (nei[cur_faces[fi]] == i)
-        {
-          cell_neighbour = own[cur_faces[fi]];
-        }
-        else
-        {
-          Info << "Dupa" << endl;
-        }
-        auto c_nei = c_centres[cell_neighbour];
-
-        scalar oq_cell = (c_nei - c_c)
-                         & face.areaNormal(mesh.points()) / mag(c_nei - c_c)
-                               / mag(face.areaNormal(mesh.points()));
-
-        oq_faces[fi] = min(oq_faces[fi], oq_cell);
-      }
+      low_oq[ci]    = q.ortho_quality[ci] < min_allowed;
+      high_skew[ci] = q.skewness[ci] > max_skewness;
     }
-    oq[i] = min(oq_faces);
-  }
 
-  scalar min_oq = min(oq);
-
-  Info << "Min. orthogonal quality = " << min_oq << endl;
-  Info << "Corresponding angle = "
-       << Foam::acos(min_oq) * 180.0 / Foam::constant::mathematical::pi << endl;
+    write_set(mesh, "lowOrthoQualityCells", low_oq);
+    write_set(mesh, "highSkewnessCells", high_skew);
+  }
 
+  Info << "End!" << endl;
   return 0;
 }
@@ -0,0 +1,90 @@
+#!/usr/bin/env python3
+"""List or extract the fields of a fieldContainer file.
+
+    ./unpackFieldContainer.py processor0/0.1/fields.foc          # list
+    ./unpackFieldContainer.py processor0/0.1/fields.foc U p      # extract
+
+The extracted fields are written next to the container as the standard
+binary field files, only the requested fields are read and inflated.
+"""
+
+import argparse
+import os
+import struct
+import sys
+import zlib
+
+MAGIC = b"FOAMFC01"
+
+
+def read_string(f):
+    (n,) = struct.unpack("<I", f.read(4))
+    return f.read(n).decode()
+
+
+def read_index(f):
+    if f.read(8) != MAGIC:
+        raise ValueError("not a fieldContainer file")
+
+    f.seek(-8, os.SEEK_END)
+    (offset,) = struct.unpack("<Q", f.read(8))
+    f.seek(offset)
+
+    (n,) = struct.unpack("<I", f.read(4))
+    index = {}
+    for _ in range(n):
+        name = read_string(f)
+        class_name = read_string(f)
+        offset, compressed, size, crc = struct.unpack("<QQQI", f.read(28))
+        index[name] = {
+            "class": class_name,
+            "offset": offset,
+            "compressed": compressed,
+            "size": size,
+            "crc": crc,
+        }
+
+    return index
+
+
+def read_field(f, entry):
+    f.seek(entry["offset"])
+    content = zlib.decompress(f.read(entry["compressed"]))
+
+    if len(content) != entry["size"] or zlib.crc32(content) != entry["crc"]:
+        raise ValueError("corrupt field")
+
+    return content
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("container")
+    parser.add_argument("fields", nargs="*")
+    args = parser.parse_args()
+
+    with open(args.container, "rb") as f:
+        index = read_index(f)
+
+        if not args.fields:
+            for name, entry in index.items():
+                print(
+                    "{:24} {:20} {:>12d} {:>12d}".format(
+                        name, entry["class"], entry["size"],
+                        entry["compressed"]
+                    )
+                )
+            return
+
+        out_dir = os.path.dirname(os.path.abspath(args.container))
+        for name in args.fields:
+            if name not in index:
+                print("No field {}".format(name), file=sys.stderr)
+                continue
+
+            with open(os.path.join(out_dir, name), "wb") as out:
+                out.write(read_field(f, index[name]))
+
+
+if __name__ == "__main__":
+    main()